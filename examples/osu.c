@@ -34,7 +34,7 @@ char buf[512], *songs;
 /* define HARDCODED to use these values from b20190226.2 (stable)
  * instead of scanning */
 char *beatmap = (char*)0x2512858, *beatmap_asm;
-char *time = (char*)0x3cf5d90, *time_asm;
+char *audio_time = (char*)0x3cf5d90, *audio_time_asm;
 char *ingame = (char*)0x2513ed4, *ingame_asm;
 int value, salt, mods, id, set_id, music_time, combo;
 double acc;
@@ -65,6 +65,17 @@ char* find_songs_folder(mfao_t m) {
   return res;
 }
 
+void add_vars(mfao_t m) {
+  mfao_clear_vars(m);
+  mfao_add_var(m, &value, 4, 10, 4, ingame, 0, 0x38, 0x1c, 0x08);
+  mfao_add_var(m, &salt, 4, 10, 4, ingame, 0, 0x38, 0x1c, 0x0c);
+  mfao_add_var(m, &id, 4, 2, 2, beatmap, 0, 0xc0);
+  mfao_add_var(m, &set_id, 4, 1, 2, beatmap, 0, 0xc4);
+  mfao_add_var(m, &music_time, 4, 200, 0, audio_time);
+  mfao_add_var(m, &combo, 4, 60, 3, ingame, 0, 0x34, 0x18);
+  mfao_add_var(m, &acc, 8, 60, 3, ingame, 0, 0x48, 0x14);
+}
+
 int main() {
   mfao_t m = mfao_new();
   mfao_set_process_name(m, "osu!.exe");
@@ -77,7 +88,8 @@ int main() {
       "E8 ? ? ? ? 8B 83");
   mfao_bind_pattern(m, &beatmap_asm,
     "8B 35 ? ? ? ? 85 F6 74 ? 8B ? ? ? ? ? ? E8 ? ? ? ? 83 F8 05");
-  mfao_bind_pattern(m, &time_asm, "A1 ? ? ? ? A3 ? ? ? ? FF 15 ? ? ? ? 83");
+  mfao_bind_pattern(m, &audio_time_asm,
+    "A1 ? ? ? ? A3 ? ? ? ? FF 15 ? ? ? ? 83");
   for (;;) {
     int ev;
     while ((ev = mfao_poll_event(m))) {
@@ -91,27 +103,22 @@ int main() {
         if (mfao_find_patterns(m)) {
           beatmap = mfao_read_ptr(m, beatmap_asm + 2);
           ingame = mfao_read_ptr(m, ingame_asm + 2);
-          time = mfao_read_ptr(m, time_asm + 1);
+          audio_time = mfao_read_ptr(m, audio_time_asm + 1);
           if (mfao_errno(m)) goto again;
           printf("beatmap: %p at %p\n", beatmap, beatmap_asm);
           printf("ingame: %p at %p\n", ingame, ingame_asm);
-          printf("time: %p at %p\n", time, time_asm);
+          printf("time: %p at %p\n", audio_time, audio_time_asm);
         } else {
           puts("scanning failed, retrying in 1s");
           sleep(1);
           goto again;
         }
       #endif
+        add_vars(m);
       }
     }
-    value = mfao_read_chain(m, 4, ingame, 0, 0x38, 0x1c, 0x08);
-    salt = mfao_read_chain(m, 4, ingame, 0, 0x38, 0x1c, 0x0c);
+    if (!mfao_tick(m)) continue;
     mods = value ^ salt;
-    id = mfao_read_chain(m, 2, beatmap, 0, 0xc0);
-    set_id = mfao_read_chain(m, 2, beatmap, 0, 0xc4);
-    music_time = mfao_read_int32(m, time);
-    combo = mfao_read_chain(m, 3, ingame, 0, 0x34, 0x18);
-    mfao_read(m, mfao_read_chain(m, 2, ingame, 0, 0x48) + 0x14, &acc, 8);
     mods_str(buf, mods);
     printf("[%d] /b/%d /s/%d %g%% %dx %s\033[K\r",
       music_time, id, set_id, acc, combo, buf);
@@ -31,7 +31,7 @@ hide_unnecessary_symbols() {
 
 hide_unnecessary_symbols
 
-$cc -shared $cflags "$@" -DMFAO_IMPLEMENTATION mfao.c \
-  $ldflags -fpic -o libmfao.so
+$cc -shared $cflags "$@" -DMFAO_IMPLEMENTATION -DMFAO_THREADS mfao.c \
+  $ldflags -lpthread -fpic -o libmfao.so
 
 [ -d "$tmp" ] && rm -rf "$tmp"
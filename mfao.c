@@ -7,6 +7,7 @@
 #define MFAO_H
 
 typedef struct mfao* mfao_t; /* opaque handle */
+typedef int mfao_pattern_t; /* pattern handle, -1 on failure */
 
 char* mfao_version_str();
 int mfao_version_major();
@@ -15,12 +16,13 @@ int mfao_version_patch();
 mfao_t mfao_new(void);
 void mfao_free(mfao_t m);
 void mfao_set_process_name(mfao_t m, char* process_name);
-void mfao_add_pattern(mfao_t m, char* pattern);
-void mfao_bind_pattern(mfao_t m, char** presult, char* pattern);
+mfao_pattern_t mfao_add_pattern(mfao_t m, char* pattern);
+mfao_pattern_t mfao_bind_pattern(mfao_t m, char** presult, char* pattern);
 void mfao_remove_pattern(mfao_t m, char* pattern);
 void mfao_clear_patterns(mfao_t m);
 void* mfao_find_patterns(mfao_t m);
 void* mfao_result(mfao_t m, char* pattern);
+void* mfao_pattern_result(mfao_t m, mfao_pattern_t pattern);
 void mfao_clear_results(mfao_t m);
 void mfao_add_range(mfao_t m, char* start, char* end);
 void mfao_add_range_by_substr(mfao_t m, char* start, char* end);
@@ -28,8 +30,35 @@ void mfao_read(mfao_t m, void* addr, void* dst, int n);
 int mfao_read_int32(mfao_t m, void* addr);
 char* mfao_read_ptr(mfao_t m, void* addr);
 char* mfao_read_chain(mfao_t m, int n, void* addr, ...);
+int mfao_read_utf16(mfao_t m, void* addr, char* dst, int n);
+int mfao_read_utf8(mfao_t m, void* addr, char* dst, int n);
+int mfao_read_clr_string(mfao_t m, void* obj, char* dst, int n);
+int mfao_read_clr_array(mfao_t m, void* obj, void* dst, int elem_size,
+  int max);
+int mfao_read_clr_ref_array(mfao_t m, void* obj, void* dst, int max);
 void mfao_set_timeout(mfao_t m, int seconds);
 int mfao_pid(mfao_t m);
+void mfao_set_threads(mfao_t m, int n);
+int mfao_pointer_scan(mfao_t m, void* target, int max_depth, int max_offset,
+  char* path);
+int mfao_pointer_rescan(mfao_t m, void* target, char* path);
+
+#define MFAO_HIST_BUCKETS 20
+typedef int mfao_var_t; /* registered read handle, -1 on failure */
+typedef struct {
+  double rate; /* per second since the stats were reset */
+  int count, errors;
+  /* bucket i counts times under 2^i microseconds, the last bucket also
+   * counts everything above that */
+  int hist[MFAO_HIST_BUCKETS];
+} mfao_stats_t;
+mfao_var_t mfao_add_var(mfao_t m, void* dst, int size, double hz, int n,
+  void* addr, ...);
+void mfao_clear_vars(mfao_t m);
+int mfao_tick(mfao_t m);
+void mfao_var_stats(mfao_t m, mfao_var_t var, mfao_stats_t* stats);
+void mfao_tick_stats(mfao_t m, mfao_stats_t* stats);
+void mfao_reset_stats(mfao_t m);
 
 #define MFAO_SILENT_BIT (1<<0) /* no terminal output */
 #define MFAO_ALL_MEMORY_BIT (1<<1) /* scan non-executable memory */
@@ -60,11 +89,19 @@ int mfao_poll_event(mfao_t m);
  * wildcarded, for example: 11 22 33 ? 44 will match
  * { 0x11, 0x22, 0x33, x, 0x44 }. spaces are optional, bytes are always
  * hex and always padded to 2 digits
+ *
+ * patterns are scanned with a skip table built from the literal bytes
+ * after the last wildcard, so a pattern that ends in a long run of
+ * literal bytes lets the scanner jump further ahead on a mismatch
  * 
  * mfao_find_patterns returns the first result. if you're working with
  * multiple patterns, you should use mfao_result or add patterns with
  * mfao_bind_pattern so the results are stored in the pointers you bind.
  * each pattern stores the first address that matches
+ *
+ * add_pattern and bind_pattern return a handle that can be passed to
+ * mfao_pattern_result. both lookups are hashed so it's cheap to resolve
+ * results in a loop. there's no cap on the number of patterns or ranges
  * 
  * *_chain functions will read a multi-level pointer
  * for example, this call
@@ -82,6 +119,67 @@ int mfao_poll_event(mfao_t m);
  * mfao_read_ptr reads 8-byte pointers of a 64-bit process is
  * detected and 4-byte for 32-bit. on a 32-bit build of mfao, you
  * can't use this function on 64-bit processes
+ *
+ * mfao_read_utf16 and mfao_read_utf8 read a 4-byte length followed by
+ * that many utf-16 units or bytes, and write it to dst as a zero
+ * terminated utf-8 string of at most n bytes. they return the length of
+ * what was written. mfao_read_clr_string does the same for a .NET
+ * System.String given the object's address, and mfao_read_clr_array
+ * copies up to max elements of a .NET array to dst and returns how many
+ * elements it copied. mfao_read_clr_array is only for arrays of
+ * primitives and value types. arrays of references on .NET Framework
+ * store the element type before the elements, so use
+ * mfao_read_clr_ref_array for those. it copies up to max references of
+ * ptr_size bytes each. each of these calls does at most two reads. the
+ * first read includes the first MFAO_READ_PREFETCH bytes of data
+ *
+ * decoded utf-16 strings are cached by address, length and a hash of
+ * their contents, so reading the same string every tick doesn't decode
+ * it again until it changes
+ *
+ * instead of reading in a loop as fast as possible, you can register
+ * vars that are read at a set rate. this call
+ *
+ *   mfao_add_var(m, &combo, 4, 60, 3, ingame, 0, 0x34, 0x18);
+ *
+ * reads 4 bytes into combo 60 times per second, from the same address
+ * that mfao_read_chain(m, 3, ingame, 0, 0x34, 0x18) would read from.
+ * with n = 0, the bytes are read straight from addr
+ *
+ * mfao_tick sleeps until at least one var is due, reads all the vars
+ * that are due around the same time and returns how many of them
+ * changed. with no vars registered, it sleeps for 100ms and returns 0.
+ * while a var's chain doesn't resolve, for example when the process is
+ * loading, it's polled less often, down to MFAO_BACKOFF_MAX times slower
+ * than its rate. mfao_var_stats reports the achieved rate
+ * and a histogram of read times for a var. mfao_tick_stats reports how
+ * many wakeups per second happen and how late they are compared to when
+ * they were scheduled
+ *
+ * mfao_pointer_scan looks for pointer chains that lead from a static
+ * address inside a mapped module to target, following at most max_depth
+ * pointers with offsets of at most max_offset bytes. chains are written
+ * to path one per line, numbers in hex except for the first two:
+ *
+ *   score depth module_offset offset1 ... offsetN module_path
+ *
+ * which means that
+ *
+ *   mfao_read_chain(m, depth + 1, module_base + module_offset, 0,
+ *     offset1, ..., offsetN)
+ *
+ * reads the value at target. module_base is the lowest address the
+ * module is mapped at. when the process restarts, find the new target
+ * address and call mfao_pointer_rescan on the same file to drop the
+ * chains that don't lead to it anymore and bump the score of the ones
+ * that do. after a few restarts, only the stable chains are left
+ *
+ * the scan reads all writable memory once per level. nodes never take
+ * more than MFAO_PSCAN_MEMORY_MAX bytes, counting the copies made while
+ * merging each level. if that's not enough the results are incomplete
+ * and a warning is printed. if mfao is built with MFAO_THREADS defined
+ * (and linked with -lpthread), the scan uses one thread per core, or as
+ * many as set with mfao_set_threads. otherwise it's single threaded
  */
 
 #define MFAO_EOK 0
@@ -124,33 +222,83 @@ int mfao_version_patch() { return MFAO_VERSION_PATCH; }
 #include <string.h>
 #include <ctype.h>
 #include <errno.h>
+#include <limits.h>
 #include <unistd.h>
 #include <dirent.h>
+#include <sys/time.h>
+#include <sys/select.h>
+#ifdef MFAO_THREADS
+#include <pthread.h>
+#endif
 
-#ifndef MFAO_PATTERNS_MAX
-#define MFAO_PATTERNS_MAX 128
+#ifndef MFAO_QUEUE_MAX
+#define MFAO_QUEUE_MAX 64
 #endif
 
-#ifndef MFAO_RANGES_MAX
-#define MFAO_RANGES_MAX 64
+#ifndef MFAO_SCAN_BUF_SIZE
+#define MFAO_SCAN_BUF_SIZE 65536
 #endif
 
-#ifndef MFAO_QUEUE_MAX
-#define MFAO_QUEUE_MAX 64
+#ifndef MFAO_READ_PREFETCH
+#define MFAO_READ_PREFETCH 256
+#endif
+
+#ifndef MFAO_STRING_CACHE_SIZE
+#define MFAO_STRING_CACHE_SIZE 64
+#endif
+
+#ifndef MFAO_CHAIN_MAX
+#define MFAO_CHAIN_MAX 16
+#endif
+
+#ifndef MFAO_BACKOFF_MAX
+#define MFAO_BACKOFF_MAX 16
+#endif
+
+#ifndef MFAO_PSCAN_MEMORY_MAX
+#define MFAO_PSCAN_MEMORY_MAX (256 * 1024 * 1024)
 #endif
 
 typedef struct {
   char* string;
-  int* mask;
-  unsigned char* bytes;
+  unsigned hash; /* of string */
+  int id;
   int len;
-  int cap;
+  size_t off; /* skip table, bytes and mask in the arena */
   char* result;
-  char** presult;
+  char** presult; /* 0 means result */
 } pattern_t;
 
 typedef struct { char* start; char* end; } range_t;
 
+typedef struct {
+  char* start;
+  char* end;
+  int module; /* index in modules, -1 if not part of one */
+  int file, rw;
+} region_t;
+
+typedef struct { char* path; char* base; } module_t;
+
+typedef struct {
+  void* dst;
+  int size;
+  char* addr;
+  int n_offsets;
+  int offsets[MFAO_CHAIN_MAX];
+  double period, cur_period, due; /* seconds */
+  double since; /* when stats started */
+  mfao_stats_t stats;
+} var_t;
+
+typedef struct {
+  char* addr;
+  int units;
+  unsigned hash; /* of the raw utf-16 data */
+  char* str; /* decoded utf-8 */
+  int len, cap;
+} str_cache_t;
+
 struct mfao {
   int flags;
   char* process_name;
@@ -158,11 +306,27 @@ struct mfao {
   char buf[512];
   char* map_substr;
   range_t matched_map;
-  int n_patterns;
-  pattern_t patterns[MFAO_PATTERNS_MAX];
-  int n_ranges;
-  range_t ranges[MFAO_RANGES_MAX];
+  pattern_t* patterns;
+  int n_patterns, patterns_cap, next_pattern_id;
+  unsigned char* arena;
+  size_t arena_len, arena_cap;
+  int *by_name, *by_id, table_cap;
+  range_t* ranges;
+  int n_ranges, ranges_cap;
   int queue[MFAO_QUEUE_MAX], queue_len;
+  unsigned char* scan_buf;
+  region_t* regions;
+  int n_regions, regions_cap;
+  module_t* modules;
+  int n_modules, modules_cap;
+  int threads;
+  unsigned char* str_buf;
+  int str_buf_cap;
+  str_cache_t* str_cache;
+  var_t* vars;
+  int n_vars, vars_cap;
+  mfao_stats_t tick_stats;
+  double tick_stats_since;
 };
 
 void println(mfao_t m, char* fmt, ...) {
@@ -186,8 +350,28 @@ void push_event(mfao_t m, int ev) {
   m->queue[m->queue_len++] = ev;
 }
 
+void clear_maps(mfao_t m);
+
 void mfao_free(mfao_t m) {
+  int i;
   mfao_remove_pattern(m, 0);
+  free(m->patterns);
+  free(m->arena);
+  free(m->by_name);
+  free(m->by_id);
+  free(m->ranges);
+  free(m->scan_buf);
+  clear_maps(m);
+  free(m->regions);
+  free(m->modules);
+  free(m->str_buf);
+  if (m->str_cache) {
+    for (i = 0; i < MFAO_STRING_CACHE_SIZE; ++i) {
+      free(m->str_cache[i].str);
+    }
+  }
+  free(m->str_cache);
+  free(m->vars);
   free(m);
 }
 
@@ -238,6 +422,24 @@ int read_file(mfao_t m, size_t buf_size, long offset, char* fmt, ...) {
   return 1;
 }
 
+/* reads up to n bytes at addr into dst, returns the number of bytes read */
+int fread_mem(FILE* f, char* addr, void* dst, int n) {
+  if (fseek(f, (long)addr, SEEK_SET) == -1) {
+    return 0;
+  }
+  return fread(dst, 1, n, f);
+}
+
+int read_mem(mfao_t m, char* addr, void* dst, int n) {
+  FILE* f = fopenf("rb", "/proc/%d/mem", m->pid);
+  if (!f) {
+    return 0;
+  }
+  n = fread_mem(f, addr, dst, n);
+  fclose(f);
+  return n;
+}
+
 int process_matches(mfao_t m, int pid) {
   if (m->process_name) {
     char* p;
@@ -366,9 +568,52 @@ void for_each_map(mfao_t m, int (*callback)(mfao_t, char*, char*, char*)) {
   fclose(f);
 }
 
+/*
+ * the skip table, bytes and wildcard mask of every pattern are packed
+ * back to back in m->arena. patterns refer to their slice by offset so
+ * growing the arena doesn't invalidate them
+ */
+
+#define pattern_skip(m, pat) ((int*)((m)->arena + (pat)->off))
+#define pattern_bytes(m, pat) ((m)->arena + (pat)->off + 256 * sizeof(int))
+#define pattern_mask(m, pat) (pattern_bytes(m, pat) + (pat)->len)
+#define is_wildcard(mask, i) ((mask)[(i) / 8] & (1<<((i) % 8)))
+
+size_t pattern_size(int len) {
+  size_t size = 256 * sizeof(int) + len + (len + 7) / 8;
+  return (size + sizeof(int) - 1) / sizeof(int) * sizeof(int);
+}
+
+char** result_ptr(pattern_t* pat) {
+  return pat->presult ? pat->presult : &pat->result;
+}
+
+int pattern_matches(mfao_t m, pattern_t* pat, unsigned char* b) {
+  int i;
+  unsigned char* bytes = pattern_bytes(m, pat);
+  unsigned char* mask = pattern_mask(m, pat);
+  for (i = pat->len - 1; i >= 0; --i) {
+    if (!is_wildcard(mask, i) && b[i] != bytes[i]) return 0;
+  }
+  for (i = 0; i < pat->len; ++i) {
+    if (is_wildcard(mask, i)) bytes[i] = b[i];
+  }
+  return 1;
+}
+
+/*
+ * scans a window of the map at a time. at each position, every pattern
+ * that's still unresolved is tested and looks up its skip table with the
+ * byte under its last position. we then jump by the smallest of those
+ * shifts, which is the furthest we can go without skipping over a
+ * possible match for any of them. the next window overlaps the current
+ * one so patterns that straddle the boundary are not missed
+ */
+
 int pattern_callback(mfao_t m, char* line, char* start, char* end) {
-  int i, j, max_pattern_len = 0;
+  int i, j, n, at_end, max_pattern_len = 0;
   char* p = line;
+  unsigned char* b;
   p += strcspn(p, " \t");
   p += strspn(p, " \t");
   if (*p != 'r' || (!(m->flags & MFAO_ALL_MEMORY_BIT) && p[2] != 'x')) {
@@ -383,32 +628,44 @@ int pattern_callback(mfao_t m, char* line, char* start, char* end) {
   for (j = 0; j < m->n_patterns; ++j) {
     max_pattern_len = al_max(max_pattern_len, m->patterns[j].len);
   }
-  for (; start < end; ++start) {
-    long off = (long)start;
-    unsigned char* b = (void*)m->buf;
+  if (!m->scan_buf) {
+    m->scan_buf = malloc(MFAO_SCAN_BUF_SIZE);
+    if (!m->scan_buf) {
+      m->error = MFAO_EOOM;
+      return 1;
+    }
+  }
+  b = m->scan_buf;
+  while (start < end) {
     println(m, "%p/%p\033[K\r", start, end);
-    max_pattern_len = al_min(max_pattern_len, end - start);
-    if (!read_file(m, max_pattern_len, off, "/proc/%d/mem", m->pid)) {
-      return 0;
+    n = (int)al_min(end - start, MFAO_SCAN_BUF_SIZE);
+    at_end = n == end - start;
+    i = read_mem(m, start, b, n);
+    if (i < n) {
+      if (i <= 0) return 0;
+      n = i;
+      at_end = 1;
     }
-    for (j = 0; j < m->n_patterns; ++j) {
-      pattern_t* pat = &m->patterns[j];
-      if (end - start < pat->len) continue;
-      for (i = 0; i < pat->len; ++i) {
-        if (pat->mask[i / 8] & (1<<(i % 8))) {
-          pat->bytes[i] = b[i];
-          continue; /* wildcard */
+    /* when more data follows, stop where the longest pattern stops
+     * fitting and pick it up again from the next window */
+    for (i = 0; at_end ? i < n : i + max_pattern_len <= n; ) {
+      int shift = n;
+      for (j = 0; j < m->n_patterns; ++j) {
+        pattern_t* pat = &m->patterns[j];
+        if (*result_ptr(pat) || i + pat->len > n) continue;
+        if (pattern_matches(m, pat, b + i)) {
+          int k;
+          *result_ptr(pat) = start + i;
+          println(m, "%p -> %s", start + i, pat->string);
+          for (k = 0; k < m->n_patterns && *result_ptr(&m->patterns[k]); ++k);
+          if (k >= m->n_patterns) return 1;
         }
-        if (b[i] != pat->bytes[i]) { ++i; break; }
-      }
-      if (b[i - 1] == pat->bytes[i - 1] && !*pat->presult) {
-        int k;
-        *pat->presult = start;
-        println(m, "%p -> %s", start, pat->string);
-        for (k = 0; k < m->n_patterns && *m->patterns[k].presult; ++k);
-        if (k >= m->n_patterns) return 1;
+        shift = al_min(shift, pattern_skip(m, pat)[b[i + pat->len - 1]]);
       }
+      i += shift;
     }
+    if (at_end) break;
+    start += i;
   }
   return 0;
 }
@@ -420,11 +677,35 @@ void* mfao_find_patterns(mfao_t m) {
   int i;
   for_each_map(m, pattern_callback);
   for (i = 0; i < m->n_patterns; ++i) {
-    if (*m->patterns[i].presult) return *m->patterns[i].presult;
+    if (*result_ptr(&m->patterns[i])) return *result_ptr(&m->patterns[i]);
   }
   return 0;
 }
 
+/*
+ * horspool skip table adapted to wildcards: a wildcard matches any byte,
+ * so no byte can shift us past the last wildcard before the final
+ * position. only the literal bytes after it get shorter shifts
+ */
+
+void build_skip_table(mfao_t m, pattern_t* pat) {
+  int i, shift = pat->len;
+  int* skip = pattern_skip(m, pat);
+  unsigned char* bytes = pattern_bytes(m, pat);
+  unsigned char* mask = pattern_mask(m, pat);
+  for (i = 0; i < pat->len - 1; ++i) {
+    if (is_wildcard(mask, i)) shift = pat->len - 1 - i;
+  }
+  for (i = 0; i < 256; ++i) {
+    skip[i] = shift;
+  }
+  for (i = 0; i < pat->len - 1; ++i) {
+    if (!is_wildcard(mask, i) && pat->len - 1 - i < skip[bytes[i]]) {
+      skip[bytes[i]] = pat->len - 1 - i;
+    }
+  }
+}
+
 int xrealloc(mfao_t m, void** p, size_t size) {
   void* tmp = realloc(*p, size);
   if (!tmp) {
@@ -436,99 +717,214 @@ int xrealloc(mfao_t m, void** p, size_t size) {
   return 1;
 }
 
-void mfao_add_pattern(mfao_t m, char* pattern) {
+/*
+ * patterns are indexed by string and by id in two open addressing hash
+ * tables with linear probing. slots hold the pattern index + 1 so that
+ * zeroed memory is an empty table. when several patterns share the same
+ * string, the first one added wins, same as a linear search would
+ */
+
+unsigned hash_str(char* s) {
+  unsigned h = 2166136261u;
+  for (; *s; ++s) {
+    h ^= (unsigned char)*s;
+    h *= 16777619u;
+  }
+  return h;
+}
+
+unsigned hash_bytes(unsigned char* p, size_t n) {
+  unsigned h = 2166136261u;
+  for (; n; --n, ++p) {
+    h ^= *p;
+    h *= 16777619u;
+  }
+  return h;
+}
+
+unsigned hash_id(int id) { return (unsigned)id * 2654435761u; }
+
+int find_by_name(mfao_t m, char* s) {
+  unsigned i;
+  if (!m->table_cap) return -1;
+  for (i = hash_str(s); m->by_name[i & (m->table_cap - 1)]; ++i) {
+    int j = m->by_name[i & (m->table_cap - 1)] - 1;
+    if (!strcmp(m->patterns[j].string, s)) return j;
+  }
+  return -1;
+}
+
+int find_by_id(mfao_t m, int id) {
+  unsigned i;
+  if (!m->table_cap) return -1;
+  for (i = hash_id(id); m->by_id[i & (m->table_cap - 1)]; ++i) {
+    int j = m->by_id[i & (m->table_cap - 1)] - 1;
+    if (m->patterns[j].id == id) return j;
+  }
+  return -1;
+}
+
+void table_insert(mfao_t m, int j) {
+  unsigned i;
+  pattern_t* pat = &m->patterns[j];
+  if (find_by_name(m, pat->string) < 0) {
+    for (i = pat->hash; m->by_name[i & (m->table_cap - 1)]; ++i);
+    m->by_name[i & (m->table_cap - 1)] = j + 1;
+  }
+  for (i = hash_id(pat->id); m->by_id[i & (m->table_cap - 1)]; ++i);
+  m->by_id[i & (m->table_cap - 1)] = j + 1;
+}
+
+int rebuild_tables(mfao_t m, int cap) {
+  int i;
+  if (cap != m->table_cap) {
+    int* by_name = calloc(cap, sizeof(int));
+    int* by_id = calloc(cap, sizeof(int));
+    if (!by_name || !by_id) {
+      free(by_name);
+      free(by_id);
+      m->error = MFAO_EOOM;
+      return 0;
+    }
+    free(m->by_name);
+    free(m->by_id);
+    m->by_name = by_name;
+    m->by_id = by_id;
+    m->table_cap = cap;
+  } else {
+    memset(m->by_name, 0, cap * sizeof(int));
+    memset(m->by_id, 0, cap * sizeof(int));
+  }
+  for (i = 0; i < m->n_patterns; ++i) {
+    table_insert(m, i);
+  }
+  return 1;
+}
+
+mfao_pattern_t mfao_add_pattern(mfao_t m, char* pattern) {
   char* p;
   char byte[3];
-  int len;
-  pattern_t* pat = &m->patterns[m->n_patterns];
-  if (m->n_patterns >= MFAO_PATTERNS_MAX) {
-    println(m, "W: pattern cap reached, ignoring");
-    m->error = MFAO_EOOM;
-    return;
+  int len = 0, n = 0;
+  size_t size;
+  pattern_t* pat;
+  unsigned char *bytes, *mask;
+  for (p = pattern; *p; ++p) {
+    if (isspace(*p)) continue;
+    if (*p != '?' && p[1]) ++p;
+    ++len;
+  }
+  if (!len || len > MFAO_SCAN_BUF_SIZE) {
+    println(m, "E: pattern must be 1-%d bytes long", MFAO_SCAN_BUF_SIZE);
+    m->error = MFAO_EINVAL;
+    return -1;
+  }
+  if (m->n_patterns >= m->patterns_cap) {
+    int cap = m->patterns_cap ? m->patterns_cap * 2 : 16;
+    if (!xrealloc(m, (void**)&m->patterns, cap * sizeof(pattern_t))) {
+      return -1;
+    }
+    m->patterns_cap = cap;
+  }
+  if ((m->n_patterns + 1) * 2 > m->table_cap) {
+    if (!rebuild_tables(m, m->table_cap ? m->table_cap * 2 : 32)) return -1;
+  }
+  size = pattern_size(len);
+  if (m->arena_len + size > m->arena_cap) {
+    size_t cap = m->arena_cap ? m->arena_cap : 4096;
+    for (; cap < m->arena_len + size; cap *= 2);
+    if (!xrealloc(m, (void**)&m->arena, cap)) return -1;
+    m->arena_cap = cap;
   }
+  pat = &m->patterns[m->n_patterns];
   memset(pat, 0, sizeof(pattern_t));
+  pat->off = m->arena_len;
+  pat->len = len;
+  bytes = pattern_bytes(m, pat);
+  mask = pattern_mask(m, pat);
+  memset(bytes, 0, len + (len + 7) / 8);
   for (p = pattern; *p; ++p) {
-    if (pat->len >= pat->cap) {
-      pat->cap = pat->cap ? pat->cap * 2 : 64;
-      if (!xrealloc(m, (void**)&pat->bytes, pat->cap)) return;
-      if (!xrealloc(m, (void**)&pat->mask, (pat->cap / 8) * 4)) return;
-    }
     if (isspace(*p)) continue;
     if (*p == '?') {
-      pat->mask[pat->len / 8] |= 1 << (pat->len % 8);
-      ++pat->len;
+      mask[n / 8] |= 1 << (n % 8);
+      ++n;
       continue;
     }
-    byte[0] = *p++; byte[1] = *p; byte[2] = 0;
-    errno = 0;
-    pat->bytes[pat->len] = strtol(byte, 0, 16);
-    if (errno) {
-      print_error(m, "strtol");
+    if (!isxdigit(p[0]) || !isxdigit(p[1])) {
+      println(m, "E: invalid byte in pattern: %s", pattern);
       m->error = MFAO_EINVAL;
-      return;
+      return -1;
     }
-    ++pat->len;
+    byte[0] = *p++; byte[1] = *p; byte[2] = 0;
+    bytes[n++] = (unsigned char)strtol(byte, 0, 16);
   }
-  len = strlen(pattern);
-  pat->string = malloc(len);
+  pat->string = malloc(strlen(pattern) + 1);
   if (!pat->string) {
     m->error = MFAO_EOOM;
-    return;
+    return -1;
   }
-  memcpy(pat->string, pattern, len);
-  pat->presult = &pat->result;
+  strcpy(pat->string, pattern);
+  build_skip_table(m, pat);
+  pat->hash = hash_str(pattern);
+  pat->id = m->next_pattern_id++;
+  m->arena_len += size;
+  table_insert(m, m->n_patterns);
   ++m->n_patterns;
+  return pat->id;
 }
 
-void mfao_bind_pattern(mfao_t m, char** presult, char* pattern) {
-  mfao_add_pattern(m, pattern);
-  m->patterns[m->n_patterns - 1].presult = presult;
-}
-
-void free_pattern(pattern_t* pat) {
-  free(pat->string);
-  free(pat->mask);
-  free(pat->bytes);
+mfao_pattern_t mfao_bind_pattern(mfao_t m, char** presult, char* pattern) {
+  mfao_pattern_t id = mfao_add_pattern(m, pattern);
+  if (id >= 0) m->patterns[m->n_patterns - 1].presult = presult;
+  return id;
 }
 
 void mfao_remove_pattern(mfao_t m, char* pattern) {
-  int i;
-  for (i = 0; i < m->n_patterns; ++i) {
-    if (!pattern || !strcmp(m->patterns[i].string, pattern)) {
-      free_pattern(&m->patterns[i]);
-      memmove(&m->patterns[i], &m->patterns[i + 1],
-        (m->n_patterns - i - 1) * sizeof(pattern_t));
+  int i, j;
+  size_t off = 0;
+  for (i = j = 0; i < m->n_patterns; ++i) {
+    pattern_t* pat = &m->patterns[i];
+    size_t size = pattern_size(pat->len);
+    if (!pattern || !strcmp(pat->string, pattern)) {
+      free(pat->string);
+      continue;
     }
+    memmove(m->arena + off, m->arena + pat->off, size);
+    pat->off = off;
+    off += size;
+    m->patterns[j++] = *pat;
   }
+  m->arena_len = off;
+  m->n_patterns = j;
+  if (m->table_cap) rebuild_tables(m, m->table_cap);
 }
 
-/* TODO: use a hash table */
 void* mfao_result(mfao_t m, char* pattern) {
-  int i;
-  for (i = 0; i < m->n_patterns; ++i) {
-    if (!strcmp(m->patterns[i].string, pattern)) {
-      return *m->patterns[i].presult;
-    }
-  }
-  return 0;
+  int i = find_by_name(m, pattern);
+  return i < 0 ? 0 : *result_ptr(&m->patterns[i]);
+}
+
+void* mfao_pattern_result(mfao_t m, mfao_pattern_t pattern) {
+  int i = find_by_id(m, pattern);
+  return i < 0 ? 0 : *result_ptr(&m->patterns[i]);
 }
 
 void mfao_clear_results(mfao_t m) {
   int i;
   for (i = 0; i < m->n_patterns; ++i) {
-    *m->patterns[i].presult = 0;
+    *result_ptr(&m->patterns[i]) = 0;
   }
 }
 
 void mfao_clear_patterns(mfao_t m) { mfao_remove_pattern(m, 0); }
 
 void mfao_add_range(mfao_t m, char* start, char* end) {
-  range_t* range = &m->ranges[m->n_ranges];
-  if (m->n_ranges >= MFAO_RANGES_MAX) {
-    println(m, "W: ranges cap reached, ignoring");
-    m->error = MFAO_EOOM;
-    return;
+  range_t* range;
+  if (m->n_ranges >= m->ranges_cap) {
+    int cap = m->ranges_cap ? m->ranges_cap * 2 : 16;
+    if (!xrealloc(m, (void**)&m->ranges, cap * sizeof(range_t))) return;
+    m->ranges_cap = cap;
   }
+  range = &m->ranges[m->n_ranges];
   range->start = start;
   range->end = end;
   ++m->n_ranges;
@@ -590,6 +986,877 @@ char* mfao_read_chain(mfao_t m, int n, void* addr, ...) {
   return value;
 }
 
+/*
+ * counted reads grab the 4-byte count along with the first
+ * MFAO_READ_PREFETCH bytes of data in one go, which is usually enough to
+ * get the whole thing. if it's not, the rest is read with one more call.
+ * the data ends up in m->str_buf
+ */
+
+unsigned char* read_counted(mfao_t m, char* addr, int data_off,
+  int unit_size, int max_units, int* pcount)
+{
+  int n, count, size;
+  wait_for_process(m);
+  if (max_units > (INT_MAX - data_off - MFAO_READ_PREFETCH) / unit_size) {
+    m->error = MFAO_EINVAL;
+    return 0;
+  }
+  size = data_off + MFAO_READ_PREFETCH;
+  if (size > m->str_buf_cap) {
+    if (!xrealloc(m, (void**)&m->str_buf, size)) return 0;
+    m->str_buf_cap = size;
+  }
+  n = read_mem(m, addr, m->str_buf, size);
+  if (n < data_off) {
+    m->error = MFAO_EIO;
+    return 0;
+  }
+  memcpy(&count, m->str_buf, 4);
+  if (count < 0) {
+    m->error = MFAO_EINVAL;
+    return 0;
+  }
+  if (count > max_units) count = max_units;
+  size = data_off + count * unit_size;
+  if (size > n) {
+    if (size > m->str_buf_cap) {
+      if (!xrealloc(m, (void**)&m->str_buf, size)) return 0;
+      m->str_buf_cap = size;
+    }
+    if (read_mem(m, addr + n, m->str_buf + n, size - n) != size - n) {
+      m->error = MFAO_EIO;
+      return 0;
+    }
+  }
+  *pcount = count;
+  return m->str_buf + data_off;
+}
+
+/* returns the number of bytes written, dst can be null to just count */
+int utf16_to_utf8(unsigned char* src, int units, char* dst) {
+  int i, n = 0;
+  for (i = 0; i < units; ++i) {
+    unsigned long c = src[i * 2] | (src[i * 2 + 1] << 8);
+    if (c >= 0xD800 && c < 0xDC00 && i + 1 < units) {
+      unsigned long lo = src[i * 2 + 2] | (src[i * 2 + 3] << 8);
+      if (lo >= 0xDC00 && lo < 0xE000) {
+        c = 0x10000 + ((c - 0xD800) << 10) + (lo - 0xDC00);
+        ++i;
+      }
+    }
+    if (c >= 0xD800 && c < 0xE000) c = 0xFFFD; /* unpaired surrogate */
+    if (c < 0x80) {
+      if (dst) dst[n] = (char)c;
+      n += 1;
+    } else if (c < 0x800) {
+      if (dst) {
+        dst[n] = (char)(0xC0 | (c >> 6));
+        dst[n + 1] = (char)(0x80 | (c & 0x3F));
+      }
+      n += 2;
+    } else if (c < 0x10000) {
+      if (dst) {
+        dst[n] = (char)(0xE0 | (c >> 12));
+        dst[n + 1] = (char)(0x80 | ((c >> 6) & 0x3F));
+        dst[n + 2] = (char)(0x80 | (c & 0x3F));
+      }
+      n += 3;
+    } else {
+      if (dst) {
+        dst[n] = (char)(0xF0 | (c >> 18));
+        dst[n + 1] = (char)(0x80 | ((c >> 12) & 0x3F));
+        dst[n + 2] = (char)(0x80 | ((c >> 6) & 0x3F));
+        dst[n + 3] = (char)(0x80 | (c & 0x3F));
+      }
+      n += 4;
+    }
+  }
+  return n;
+}
+
+/* copies as much of a utf-8 string as fits without cutting a character */
+int copy_utf8(char* dst, int n, char* src, int len) {
+  if (n <= 0) return 0;
+  if (len > n - 1) {
+    len = n - 1;
+    while (len > 0 && (src[len] & 0xC0) == 0x80) --len;
+  }
+  memcpy(dst, src, len);
+  dst[len] = 0;
+  return len;
+}
+
+/*
+ * decoded utf-16 strings are cached in a direct mapped table indexed by
+ * address. an entry is only reused when the length and a hash of the raw
+ * data match, so a string that changed in place is decoded again
+ */
+
+str_cache_t* find_str_cache(mfao_t m, char* addr, int units,
+  unsigned char* data)
+{
+  str_cache_t* entry;
+  unsigned hash;
+  int len;
+  if (!m->str_cache) {
+    m->str_cache = calloc(MFAO_STRING_CACHE_SIZE, sizeof(str_cache_t));
+    if (!m->str_cache) {
+      m->error = MFAO_EOOM;
+      return 0;
+    }
+  }
+  hash = hash_bytes(data, units * 2);
+  entry = &m->str_cache[
+    hash_id((int)((size_t)addr >> 1)) % MFAO_STRING_CACHE_SIZE];
+  if (entry->addr == addr && entry->units == units && entry->hash == hash) {
+    return entry;
+  }
+  len = utf16_to_utf8(data, units, 0);
+  if (len + 1 > entry->cap) {
+    if (!xrealloc(m, (void**)&entry->str, len + 1)) return 0;
+    entry->cap = len + 1;
+  }
+  utf16_to_utf8(data, units, entry->str);
+  entry->str[len] = 0;
+  entry->len = len;
+  entry->addr = addr;
+  entry->units = units;
+  entry->hash = hash;
+  return entry;
+}
+
+int mfao_read_utf16(mfao_t m, void* addr, char* dst, int n) {
+  int units;
+  unsigned char* data;
+  str_cache_t* entry;
+  if (n <= 0) return 0;
+  *dst = 0;
+  data = read_counted(m, addr, 4, 2, n - 1, &units);
+  if (!data) return 0;
+  entry = find_str_cache(m, addr, units, data);
+  if (!entry) return 0;
+  return copy_utf8(dst, n, entry->str, entry->len);
+}
+
+int mfao_read_utf8(mfao_t m, void* addr, char* dst, int n) {
+  int len;
+  unsigned char* data;
+  if (n <= 0) return 0;
+  *dst = 0;
+  data = read_counted(m, addr, 4, 1, n - 1, &len);
+  if (!data) return 0;
+  return copy_utf8(dst, n, (char*)data, len);
+}
+
+int mfao_read_clr_string(mfao_t m, void* obj, char* dst, int n) {
+  wait_for_process(m);
+  return mfao_read_utf16(m, (char*)obj + m->ptr_size, dst, n);
+}
+
+int mfao_read_clr_array(mfao_t m, void* obj, void* dst, int elem_size,
+  int max)
+{
+  int count;
+  unsigned char* data;
+  wait_for_process(m);
+  if (elem_size <= 0 || max < 0) {
+    m->error = MFAO_EINVAL;
+    return 0;
+  }
+  data = read_counted(m, (char*)obj + m->ptr_size, m->ptr_size, elem_size,
+    max, &count);
+  if (!data) return 0;
+  memcpy(dst, data, count * elem_size);
+  return count;
+}
+
+/* arrays of references have the element type handle before the data */
+int mfao_read_clr_ref_array(mfao_t m, void* obj, void* dst, int max) {
+  int count;
+  unsigned char* data;
+  wait_for_process(m);
+  if (max < 0) {
+    m->error = MFAO_EINVAL;
+    return 0;
+  }
+  data = read_counted(m, (char*)obj + m->ptr_size, m->ptr_size * 2,
+    m->ptr_size, max, &count);
+  if (!data) return 0;
+  memcpy(dst, data, count * m->ptr_size);
+  return count;
+}
+
+/*
+ * pointer scanner. each level reads all writable memory and collects the
+ * pointers that land at most max_offset bytes before any node found in
+ * the previous level, one node per pointer and node it lands before,
+ * starting from the target. this is a reverse index of
+ * the pointer values restricted to the ones we care about, which keeps
+ * memory proportional to the results rather than to the size of the
+ * heap. nodes that sit inside a module are chain roots and get written
+ * out instead of being expanded further
+ */
+
+typedef struct { char* addr; int parent, offset; } pnode_t;
+
+typedef struct {
+  mfao_t m;
+  pnode_t* frontier; /* sorted by addr */
+  int n_frontier;
+  char *lo, *hi; /* range of values that can hit the frontier */
+  int max_offset;
+  int region;
+  char* cursor;
+  size_t budget; /* bytes left for new nodes */
+  int truncated, error;
+#ifdef MFAO_THREADS
+  pthread_mutex_t lock;
+#endif
+} pscan_t;
+
+typedef struct {
+  pscan_t* ps;
+  unsigned char* buf;
+  pnode_t* found;
+  int n_found, found_cap;
+} pworker_t;
+
+#ifdef MFAO_THREADS
+#define pscan_lock(ps) pthread_mutex_lock(&(ps)->lock)
+#define pscan_unlock(ps) pthread_mutex_unlock(&(ps)->lock)
+#else
+#define pscan_lock(ps)
+#define pscan_unlock(ps)
+#endif
+
+char* map_field(char* p, int n) {
+  for (; n > 0; --n) {
+    p += strcspn(p, " \t");
+    p += strspn(p, " \t");
+  }
+  return p;
+}
+
+/*
+ * every file backed map is a module, based at the lowest address it's
+ * mapped at. an anonymous map right after a file backed one is usually
+ * its bss so it's considered part of the same module
+ */
+
+int collect_maps_callback(mfao_t m, char* line, char* start, char* end) {
+  char* perms = map_field(line, 1);
+  char* path = map_field(line, 5);
+  region_t* prev = m->n_regions ? &m->regions[m->n_regions - 1] : 0;
+  region_t* r;
+  int module = -1;
+  if (*path == '/') {
+    for (module = m->n_modules - 1; module >= 0; --module) {
+      if (!strcmp(m->modules[module].path, path)) break;
+    }
+    if (module < 0) {
+      module_t* mod;
+      if (m->n_modules >= m->modules_cap) {
+        int cap = m->modules_cap ? m->modules_cap * 2 : 64;
+        if (!xrealloc(m, (void**)&m->modules, cap * sizeof(module_t))) {
+          return 1;
+        }
+        m->modules_cap = cap;
+      }
+      mod = &m->modules[m->n_modules];
+      mod->path = malloc(strlen(path) + 1);
+      if (!mod->path) {
+        m->error = MFAO_EOOM;
+        return 1;
+      }
+      strcpy(mod->path, path);
+      mod->base = start;
+      module = m->n_modules++;
+    }
+  } else if (!*path && prev && prev->file && prev->end == start) {
+    module = prev->module;
+  }
+  if (m->n_regions >= m->regions_cap) {
+    int cap = m->regions_cap ? m->regions_cap * 2 : 256;
+    if (!xrealloc(m, (void**)&m->regions, cap * sizeof(region_t))) {
+      return 1;
+    }
+    m->regions_cap = cap;
+  }
+  r = &m->regions[m->n_regions++];
+  r->start = start;
+  r->end = end;
+  r->module = module;
+  r->file = *path == '/';
+  r->rw = perms[0] == 'r' && perms[1] == 'w';
+  return 0;
+}
+
+void clear_maps(mfao_t m) {
+  int i;
+  for (i = 0; i < m->n_modules; ++i) {
+    free(m->modules[i].path);
+  }
+  m->n_modules = 0;
+  m->n_regions = 0;
+}
+
+void collect_maps(mfao_t m) {
+  clear_maps(m);
+  for_each_map(m, collect_maps_callback);
+}
+
+int find_region(mfao_t m, char* addr) {
+  int lo = 0, hi = m->n_regions - 1;
+  while (lo <= hi) {
+    int mid = (lo + hi) / 2;
+    if (addr < m->regions[mid].start) hi = mid - 1;
+    else if (addr >= m->regions[mid].end) lo = mid + 1;
+    else return mid;
+  }
+  return -1;
+}
+
+/* first node with addr >= value */
+int lower_bound(pnode_t* nodes, int n, char* value) {
+  int lo = 0, hi = n;
+  while (lo < hi) {
+    int mid = (lo + hi) / 2;
+    if (nodes[mid].addr < value) lo = mid + 1;
+    else hi = mid;
+  }
+  return lo;
+}
+
+int cmp_pnode(const void* a, const void* b) {
+  const pnode_t* x = a;
+  const pnode_t* y = b;
+  if (x->addr != y->addr) return x->addr < y->addr ? -1 : 1;
+  return x->offset - y->offset;
+}
+
+char* load_ptr(unsigned char* p, int size) {
+  if (size == 4) {
+    unsigned int v;
+    memcpy(&v, p, 4);
+    return (char*)(size_t)v;
+  } else {
+    char* v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+  }
+}
+
+int pscan_next_chunk(pscan_t* ps, char** start, int* n) {
+  mfao_t m = ps->m;
+  int res = 0;
+  pscan_lock(ps);
+  while (!ps->truncated && !ps->error && ps->region < m->n_regions) {
+    region_t* r = &m->regions[ps->region];
+    if (!r->rw || ps->cursor >= r->end) {
+      if (++ps->region < m->n_regions) {
+        ps->cursor = m->regions[ps->region].start;
+      }
+      continue;
+    }
+    *start = ps->cursor;
+    *n = r->end - ps->cursor < MFAO_SCAN_BUF_SIZE ?
+      (int)(r->end - ps->cursor) : MFAO_SCAN_BUF_SIZE;
+    ps->cursor += *n;
+    res = 1;
+    break;
+  }
+  pscan_unlock(ps);
+  return res;
+}
+
+int pscan_push(pworker_t* w, char* addr, int parent, int offset) {
+  pscan_t* ps = w->ps;
+  pnode_t* node;
+  if (w->n_found >= w->found_cap) {
+    int block = 4096, truncated;
+    pscan_lock(ps);
+    if (ps->budget < block * sizeof(pnode_t)) {
+      ps->truncated = 1;
+    } else {
+      ps->budget -= block * sizeof(pnode_t);
+    }
+    truncated = ps->truncated;
+    pscan_unlock(ps);
+    if (truncated) return 0;
+    node = realloc(w->found, (w->found_cap + block) * sizeof(pnode_t));
+    if (!node) {
+      pscan_lock(ps);
+      ps->error = MFAO_EOOM;
+      pscan_unlock(ps);
+      return 0;
+    }
+    w->found = node;
+    w->found_cap += block;
+  }
+  node = &w->found[w->n_found++];
+  node->addr = addr;
+  node->parent = parent;
+  node->offset = offset;
+  return 1;
+}
+
+void* pscan_worker(void* arg) {
+  pworker_t* w = arg;
+  pscan_t* ps = w->ps;
+  int ptr_size = ps->m->ptr_size;
+  char* start;
+  int n, i, j;
+  while (pscan_next_chunk(ps, &start, &n)) {
+    n = read_mem(ps->m, start, w->buf, n);
+    for (i = 0; i + ptr_size <= n; i += ptr_size) {
+      char* value = load_ptr(w->buf + i, ptr_size);
+      if (value < ps->lo || value > ps->hi) continue;
+      j = lower_bound(ps->frontier, ps->n_frontier, value);
+      for (; j < ps->n_frontier; ++j) {
+        int offset;
+        if (ps->frontier[j].addr - value > ps->max_offset) break;
+        offset = (int)(ps->frontier[j].addr - value);
+        if (!pscan_push(w, start + i, j, offset)) return 0;
+      }
+    }
+  }
+  return 0;
+}
+
+void pscan_run(pscan_t* ps, pworker_t* workers, int n_threads) {
+  int i;
+#ifdef MFAO_THREADS
+  pthread_t* threads = calloc(n_threads, sizeof(pthread_t));
+  if (threads) {
+    for (i = 1; i < n_threads; ++i) {
+      if (pthread_create(&threads[i], 0, pscan_worker, &workers[i])) break;
+    }
+    n_threads = i;
+  } else {
+    n_threads = 1;
+  }
+  pscan_worker(&workers[0]);
+  for (i = 1; i < n_threads; ++i) {
+    pthread_join(threads[i], 0);
+  }
+  free(threads);
+#else
+  for (i = 0; i < n_threads; ++i) {
+    pscan_worker(&workers[i]);
+  }
+#endif
+}
+
+/* true if addr is already on the path from node back to the target */
+int is_cycle(pnode_t** levels, int depth, pnode_t* node, char* addr) {
+  for (; depth > 0; --depth) {
+    node = &levels[depth - 1][node->parent];
+    if (node->addr == addr) return 1;
+  }
+  return 0;
+}
+
+void write_chain(FILE* f, pnode_t** levels, int depth, pnode_t* node,
+  module_t* mod)
+{
+  fprintf(f, "1 %d %lx", depth, (unsigned long)(node->addr - mod->base));
+  for (; depth > 0; --depth) {
+    fprintf(f, " %x", node->offset);
+    node = &levels[depth - 1][node->parent];
+  }
+  fprintf(f, " %s\n", mod->path);
+}
+
+int mfao_pointer_scan(mfao_t m, void* target, int max_depth, int max_offset,
+  char* path)
+{
+  FILE* f;
+  pscan_t ps;
+  pworker_t* workers;
+  pnode_t** levels;
+  int* n_levels;
+  int depth, i, j, n_threads, n_chains = 0;
+  size_t left = MFAO_PSCAN_MEMORY_MAX - sizeof(pnode_t);
+  if (max_depth < 1 || max_offset < 0) {
+    m->error = MFAO_EINVAL;
+    return 0;
+  }
+  collect_maps(m);
+  if (m->error) return 0;
+  f = fopen(path, "w");
+  if (!f) {
+    print_error(m, "fopen");
+    m->error = MFAO_EIO;
+    return 0;
+  }
+#ifdef MFAO_THREADS
+  n_threads = m->threads;
+  if (n_threads < 1) n_threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+  if (n_threads < 1) n_threads = 1;
+#else
+  n_threads = 1;
+#endif
+  memset(&ps, 0, sizeof(ps));
+  ps.m = m;
+  ps.max_offset = max_offset;
+#ifdef MFAO_THREADS
+  pthread_mutex_init(&ps.lock, 0);
+#endif
+  levels = calloc(max_depth + 1, sizeof(pnode_t*));
+  n_levels = calloc(max_depth + 1, sizeof(int));
+  workers = calloc(n_threads, sizeof(pworker_t));
+  if (!levels || !n_levels || !workers) {
+    ps.error = MFAO_EOOM;
+    goto cleanup;
+  }
+  for (i = 0; i < n_threads; ++i) {
+    workers[i].ps = &ps;
+    workers[i].buf = malloc(MFAO_SCAN_BUF_SIZE);
+    if (!workers[i].buf) {
+      ps.error = MFAO_EOOM;
+      goto cleanup;
+    }
+  }
+  levels[0] = calloc(1, sizeof(pnode_t));
+  if (!levels[0]) {
+    ps.error = MFAO_EOOM;
+    goto cleanup;
+  }
+  levels[0]->addr = target;
+  n_levels[0] = 1;
+  for (depth = 1; depth <= max_depth && n_levels[depth - 1]; ++depth) {
+    pnode_t* nodes;
+    int n_nodes = 0, keep = 0;
+    println(m, "pointer scan: depth %d, %d nodes", depth, n_levels[depth - 1]);
+    ps.frontier = levels[depth - 1];
+    ps.n_frontier = n_levels[depth - 1];
+    ps.lo = ps.frontier[0].addr;
+    ps.lo -= (size_t)ps.lo < (size_t)max_offset ? (size_t)ps.lo : max_offset;
+    ps.hi = ps.frontier[ps.n_frontier - 1].addr;
+    ps.region = 0;
+    ps.cursor = m->n_regions ? m->regions[0].start : 0;
+    /* workers get half of what's left, the other half is where the nodes
+     * they found are merged before their buffers are freed */
+    ps.budget = left / 2;
+    pscan_run(&ps, workers, n_threads);
+    if (ps.error) break;
+    for (i = 0; i < n_threads; ++i) {
+      n_nodes += workers[i].n_found;
+    }
+    nodes = malloc((n_nodes ? n_nodes : 1) * sizeof(pnode_t));
+    if (!nodes) {
+      ps.error = MFAO_EOOM;
+      break;
+    }
+    for (n_nodes = 0, i = 0; i < n_threads; ++i) {
+      if (workers[i].n_found) {
+        memcpy(nodes + n_nodes, workers[i].found,
+          workers[i].n_found * sizeof(pnode_t));
+      }
+      n_nodes += workers[i].n_found;
+      free(workers[i].found);
+      workers[i].found = 0;
+      workers[i].n_found = workers[i].found_cap = 0;
+    }
+    /* an address reached through several parents keeps a node for each
+     * of them, so every chain through it is still found */
+    qsort(nodes, n_nodes, sizeof(pnode_t), cmp_pnode);
+    for (i = 0; i < n_nodes; ++i) {
+      char* addr = nodes[i].addr;
+      if (is_cycle(levels, depth, &nodes[i], addr)) continue;
+      j = find_region(m, addr);
+      if (j >= 0 && m->regions[j].module >= 0) {
+        write_chain(f, levels, depth, &nodes[i],
+          &m->modules[m->regions[j].module]);
+        ++n_chains;
+        continue;
+      }
+      nodes[keep++] = nodes[i];
+    }
+    if (keep) {
+      pnode_t* tmp = realloc(nodes, keep * sizeof(pnode_t));
+      if (tmp) nodes = tmp;
+    }
+    left -= keep * sizeof(pnode_t);
+    levels[depth] = nodes;
+    n_levels[depth] = keep;
+    if (ps.truncated) break;
+  }
+  if (ps.truncated) {
+    println(m, "W: pointer scan hit the memory cap, results are incomplete");
+  }
+  println(m, "pointer scan: found %d chains", n_chains);
+cleanup:
+  if (ps.error) m->error = ps.error;
+  if (workers) {
+    for (i = 0; i < n_threads; ++i) {
+      free(workers[i].buf);
+      free(workers[i].found);
+    }
+  }
+  if (levels) {
+    for (i = 0; i <= max_depth; ++i) {
+      free(levels[i]);
+    }
+  }
+  free(workers);
+  free(levels);
+  free(n_levels);
+#ifdef MFAO_THREADS
+  pthread_mutex_destroy(&ps.lock);
+#endif
+  if (fclose(f)) {
+    print_error(m, "fclose");
+    m->error = MFAO_EIO;
+  }
+  return n_chains;
+}
+
+int mfao_pointer_rescan(mfao_t m, void* target, char* path) {
+  FILE *in, *out;
+  char line[8192], tmp[512];
+  int n_chains = 0, error = m->error;
+  collect_maps(m);
+  if (m->error) return 0;
+  if (strlen(path) + 5 > sizeof(tmp)) {
+    m->error = MFAO_EINVAL;
+    return 0;
+  }
+  sprintf(tmp, "%s.tmp", path);
+  in = fopen(path, "r");
+  out = in ? fopen(tmp, "w") : 0;
+  if (!out) {
+    print_error(m, "fopen");
+    if (in) fclose(in);
+    m->error = MFAO_EIO;
+    return 0;
+  }
+  while (fgets(line, sizeof(line), in)) {
+    char *p, *addr;
+    int score, depth, i;
+    long module_offset;
+    line[strcspn(line, "\n")] = 0;
+    score = (int)strtol(line, &p, 10);
+    depth = (int)strtol(p, &p, 10);
+    module_offset = strtol(p, &p, 16);
+    p = map_field(p, depth + 1);
+    for (i = 0; i < m->n_modules; ++i) {
+      if (!strcmp(m->modules[i].path, p)) break;
+    }
+    if (depth < 1 || i >= m->n_modules) continue;
+    addr = m->modules[i].base + module_offset;
+    p = map_field(line, 3);
+    m->error = 0;
+    for (i = 0; i < depth && !m->error; ++i) {
+      /* values read from the target can be anything, so do the math on
+       * integers instead of risking pointer overflow */
+      addr = (char*)((size_t)mfao_read_ptr(m, addr) +
+        (size_t)(int)strtol(p, &p, 16));
+    }
+    if (!m->error && addr == (char*)target) {
+      fprintf(out, "%d%s\n", score + 1, line + strcspn(line, " "));
+      ++n_chains;
+    }
+  }
+  m->error = error;
+  fclose(in);
+  if (fclose(out) || rename(tmp, path)) {
+    print_error(m, "rename");
+    m->error = MFAO_EIO;
+  }
+  println(m, "pointer rescan: %d chains left", n_chains);
+  return n_chains;
+}
+
+void mfao_set_threads(mfao_t m, int n) { m->threads = n; }
+
+/*
+ * registered reads. mfao_tick sleeps until the earliest var is due and
+ * then reads every var that's due within a quarter of its period, so
+ * vars with related rates end up sharing wakeups and a single open of
+ * /proc/pid/mem. a var whose chain doesn't resolve doubles its period up
+ * to MFAO_BACKOFF_MAX times the target and goes back to full rate as
+ * soon as it reads fine again
+ *
+ * time comes from gettimeofday because CLOCK_MONOTONIC isn't available
+ * in c89, so the clock can step backwards. a sleep never lasts longer
+ * than the shortest period. vars read early can be due up to 1.25 of
+ * their period ahead, so if the earliest due time is more than twice
+ * the shortest period ahead of now, the clock must have stepped. every
+ * due time is then moved to now and the stats start times are shifted
+ * by the step. negative latency samples count as 0
+ */
+
+double now_sec(void) {
+  struct timeval tv;
+  gettimeofday(&tv, 0);
+  return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+void sleep_sec(double seconds) {
+  struct timeval tv;
+  tv.tv_sec = (long)seconds;
+  tv.tv_usec = (long)((seconds - tv.tv_sec) * 1e6);
+  select(0, 0, 0, 0, &tv);
+}
+
+void stats_add(mfao_stats_t* stats, double seconds) {
+  int i;
+  double us = seconds > 0 ? seconds * 1e6 : 0;
+  for (i = 0; i < MFAO_HIST_BUCKETS - 1 && us >= (double)(1L << i); ++i);
+  ++stats->hist[i];
+  ++stats->count;
+}
+
+mfao_var_t mfao_add_var(mfao_t m, void* dst, int size, double hz, int n,
+  void* addr, ...)
+{
+  var_t* var;
+  int i;
+  va_list va;
+  if (size <= 0 || size > (int)sizeof(m->buf) || hz <= 0 || n < 0 ||
+      n > MFAO_CHAIN_MAX)
+  {
+    m->error = MFAO_EINVAL;
+    return -1;
+  }
+  if (m->n_vars >= m->vars_cap) {
+    int cap = m->vars_cap ? m->vars_cap * 2 : 16;
+    if (!xrealloc(m, (void**)&m->vars, cap * sizeof(var_t))) return -1;
+    m->vars_cap = cap;
+  }
+  var = &m->vars[m->n_vars];
+  memset(var, 0, sizeof(var_t));
+  var->dst = dst;
+  var->size = size;
+  var->addr = addr;
+  var->n_offsets = n;
+  va_start(va, addr);
+  for (i = 0; i < n; ++i) {
+    var->offsets[i] = va_arg(va, int);
+  }
+  va_end(va);
+  var->period = var->cur_period = 1 / hz;
+  var->due = var->since = now_sec();
+  return m->n_vars++;
+}
+
+void mfao_clear_vars(mfao_t m) { m->n_vars = 0; }
+
+int read_var(mfao_t m, FILE* f, var_t* var, void* dst) {
+  char* addr = var->addr;
+  int i;
+  for (i = 0; i < var->n_offsets - 1; ++i) {
+    char* p = 0;
+    if (fread_mem(f, addr + var->offsets[i], &p, m->ptr_size) !=
+        m->ptr_size)
+    {
+      return 0;
+    }
+    addr = p;
+  }
+  if (var->n_offsets) addr += var->offsets[var->n_offsets - 1];
+  return fread_mem(f, addr, dst, var->size) == var->size;
+}
+
+int mfao_tick(mfao_t m) {
+  FILE* f;
+  double now, next, min_period;
+  int i, changed = 0;
+  if (!m->n_vars) {
+    /* don't let callers that loop on this spin while there's nothing to
+     * read, for example before the vars are registered */
+    sleep_sec(0.1);
+    return 0;
+  }
+  wait_for_process(m);
+  if (!m->tick_stats_since) m->tick_stats_since = now_sec();
+  next = m->vars[0].due;
+  min_period = m->vars[0].cur_period;
+  for (i = 1; i < m->n_vars; ++i) {
+    if (m->vars[i].due < next) next = m->vars[i].due;
+    if (m->vars[i].cur_period < min_period) {
+      min_period = m->vars[i].cur_period;
+    }
+  }
+  now = now_sec();
+  if (next - now > min_period * 2) {
+    double step = next - now;
+    for (i = 0; i < m->n_vars; ++i) {
+      m->vars[i].due = now;
+      m->vars[i].since -= step;
+    }
+    m->tick_stats_since -= step;
+    next = now;
+  }
+  if (next > now) {
+    sleep_sec(next - now < min_period ? next - now : min_period);
+    now = now_sec();
+  }
+  stats_add(&m->tick_stats, now > next ? now - next : 0);
+  f = fopenf("rb", "/proc/%d/mem", m->pid);
+  if (!f) {
+    m->error = MFAO_EIO;
+    return 0;
+  }
+  setvbuf(f, 0, _IONBF, 0);
+  for (i = 0; i < m->n_vars; ++i) {
+    var_t* var = &m->vars[i];
+    double start;
+    int ok;
+    if (var->due > now + var->cur_period / 4) continue;
+    start = now_sec();
+    ok = read_var(m, f, var, m->buf);
+    stats_add(&var->stats, now_sec() - start);
+    if (ok) {
+      if (memcmp(var->dst, m->buf, var->size)) {
+        memcpy(var->dst, m->buf, var->size);
+        ++changed;
+      }
+      var->cur_period = var->period;
+    } else {
+      ++var->stats.errors;
+      var->cur_period *= 2;
+      if (var->cur_period > var->period * MFAO_BACKOFF_MAX) {
+        var->cur_period = var->period * MFAO_BACKOFF_MAX;
+      }
+    }
+    var->due += var->cur_period;
+    if (var->due < now) var->due = now + var->cur_period;
+  }
+  fclose(f);
+  return changed;
+}
+
+void mfao_var_stats(mfao_t m, mfao_var_t v, mfao_stats_t* stats) {
+  double elapsed;
+  if (v < 0 || v >= m->n_vars) {
+    m->error = MFAO_EINVAL;
+    return;
+  }
+  *stats = m->vars[v].stats;
+  elapsed = now_sec() - m->vars[v].since;
+  stats->rate = elapsed > 0 ? stats->count / elapsed : 0;
+}
+
+void mfao_tick_stats(mfao_t m, mfao_stats_t* stats) {
+  double elapsed = now_sec() - m->tick_stats_since;
+  *stats = m->tick_stats;
+  stats->rate = elapsed > 0 ? stats->count / elapsed : 0;
+}
+
+void mfao_reset_stats(mfao_t m) {
+  int i;
+  double now = now_sec();
+  for (i = 0; i < m->n_vars; ++i) {
+    memset(&m->vars[i].stats, 0, sizeof(mfao_stats_t));
+    m->vars[i].since = now;
+  }
+  memset(&m->tick_stats, 0, sizeof(mfao_stats_t));
+  m->tick_stats_since = now;
+}
+
 void mfao_set_timeout(mfao_t m, int seconds) {
   m->timeout = seconds;
 }